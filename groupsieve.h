@@ -23,31 +23,397 @@ SOFTWARE.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #ifndef GROUPSIEVE_H
+#define GROUPSIEVE_H
 
-#define BLOCK_SIZE 32000  //Should probably be set to L1 cache size for fastest speed
-#define PARRAY_SIZE 100000 //Sets the size of the primes array. More than enough given MAX_NUMBER.
-#define NUM_THREADS 4 //Sets the number of threads to use.  Should probably equal number of cores
-#define MAX_NUMBER 10000000000 
-//MAX_NUMBER is the limit on memory, in bytes, that will be malloc'd. Not this
-//much memory will be malloc'd unless you want to find all primes up to 10 times this number.
-//This will be removed in the future.
-
-//Function declarations
-void printInstructions(char*);
-inline int getWheelSize(int);
-int rollWheel(int, int);
-void finishPrimes(int);
-void multiFinishPrimes(int);
-void* primeThread(void*);
-void getPrimes(u_int64_t);
-void wheelRemove(u_int8_t, unsigned int);
-inline void getCycleInfo(u_int64_t);
-inline void determineGroup(u_int64_t);
-inline void singleRemoveComposites(u_int64_t, u_int64_t);
-inline void multiRemoveComposites(u_int64_t, u_int64_t);
-void singlePrintPrimes(u_int64_t);
+#define CHUNK_BLOCKS 64 //The most blocks a thread sieves in a row before taking another chunk
+#define BUCKET_ENTRIES 1024 //The number of primes that fit in one bucket
+#define PRINT_BUFFER 1048576 //The number of bytes of text the printer holds before writing them out
+#define TEXT_BUFFER 65536 //The starting size of the text for one block.  It grows if it needs to.
+#define PRINT_CHUNK_BLOCKS 8 //The most blocks in a chunk when printing, so the threads stay close together
+#define OUTPUT_CHUNKS 2 //The number of chunks of text per thread that can wait for the writer
+#define KERNEL_CYCLES 8 //The fewest cycles a prime needs in a block to get the kernel for its residue
+
+//The phases of sieving a range, which phaseTimes keeps the time of
+#define PHASE_WHEEL 0 //Rolling the wheel
+#define PHASE_PRIMES 1 //Getting the sieving primes
+#define PHASE_SIEVE 2 //Sieving the range
+#define PHASE_OUTPUT 3 //Handing out the sieving primes and waiting for the writer to finish
+#define PHASES 4
+//The ways the primes can be printed.  See the explanation in groupsieve.c.
+#define FORMAT_TEXT 0 //Decimal, one per line
+#define FORMAT_U32 1 //4 bytes each, little endian
+#define FORMAT_U64 2 //8 bytes each, little endian
+#define FORMAT_DELTA8 3 //Half the gap from the last prime in a byte
+#define FORMAT_VARINT 4 //The gap from the last prime as a LEB128 varint
+#define FORMAT_BITMAP 5 //The sieved slots as they are
+#define FORMATS 6
+
+#define STORE_MAGIC "gsieve\0\0" //The first 8 bytes of a file written by gs_save
+#define STORE_VERSION 1 //The version of the layout of those files
+#define RANK_SLOTS 64 //The number of slots, i.e. 512 bits, between the prime counts in a store's index
+#define SELECT_SAMPLE 4096 //The index remembers where every SELECT_SAMPLEth prime of a store is
+
+#define CHECKPOINT_MAGIC "gscheck\0" //The first 8 bytes of a checkpoint file
+#define CHECKPOINT_VERSION 2 //The version of the layout of those files
+#define CHECKPOINT_CHUNKS 64 //The chunks per thread in each span of blocks sieved between checkpoints
+
+#define PERF_EVENTS 5 //The number of hardware counters --perf reads for each phase
+
+//Counting uses the popcnt instruction when the CPU has it.  The compiler doesn't use it by
+//default, so on x86 countPrimes is built both ways and the right one is picked when the
+//program starts.
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__POPCNT__)
+#define POPCOUNT_CLONES __attribute__((target_clones("popcnt", "default")))
+#else
+#define POPCOUNT_CLONES
+#endif
+
+//A prime bigger than a block, waiting in a bucket for the next block it hits.
+//prime is the prime's index shifted up by 3, with its place in its cycle in the
+//bottom 3 bits.  offset is where its next multiple is in that block.
+typedef struct
+{
+	u_int32_t prime;
+	u_int32_t offset;
+} bucketEntry;
+
+typedef struct bucket
+{
+	struct bucket* next;
+	u_int32_t count;
+	bucketEntry entries[BUCKET_ENTRIES];
+} bucket;
+
+//Turns primes into text, or into one of the binary formats.  See the explanation in 
+//groupsieve.c.  A printer with an fd of -1 keeps everything in its buffer, making it 
+//bigger when it fills up.  last is the last prime it printed, or 0 if the next one 
+//has to be given in full.  failed is set if the buffer couldn't be made bigger or 
+//written out, and whatever was in it is lost.
+typedef struct
+{
+	int fd;
+	int format;
+	u_int64_t last;
+	char* buf;
+	size_t used;
+	size_t size;
+	char digits[20];
+	int first;
+	u_int64_t base;
+	int failed;
+} primePrinter;
+
+//The text of one block, waiting for the writer thread.  Once it's written, buf is 
+//kept as a spare for whoever queues a block here next.
+typedef struct
+{
+	char* buf;
+	size_t used;
+	size_t size;
+	int ready;
+} outputBlock;
+
+//A sieving prime.  Sieving primes are never more than sqrt(2^64), so they fit in 32 
+//bits.  residue is the row of masks the prime uses.  There are a lot of them near the 
+//top of the range, so the jumps in their cycles are worked out when they're needed 
+//instead of kept here, except for the primes smaller than a block, whose jumps every
+//worker keeps with them in its smallPrimes.
+typedef struct
+{
+	u_int32_t prime;
+	u_int8_t residue;
+} sievingPrime;
+
+//A prime smaller than a block, with the jumps in its cycle and where a thread is in it,
+//all in one place so sieving a block goes through the small primes in order without
+//jumping around in memory.  next is where the cycle starts, relative to the start of 
+//the next block, and cycle is the next jump in it to remove.  The prime is smaller 
+//than a block, so next fits in 32 bits.
+typedef struct
+{
+	sievingPrime sp;
+	u_int32_t jumps[8];
+	int32_t next;
+	u_int8_t cycle;
+} smallPrime;
+
+//The hardware counters a thread has open for the phase it's working on.  An fd of -1
+//is a counter that couldn't be opened.
+typedef struct
+{
+	int fds[PERF_EVENTS];
+} perfCounters;
+
+//Everything one thread needs to sieve: the sieve it's working for, its block, the
+//buckets of large primes for the blocks of the chunk it is working on, its own copy of
+//the small primes, with its place in each one's cycle, the text of the block if printing and the number of primes it has
+//found ending in 1, 3, 7 and 9 if counting.  openEnded is set for an iterator's worker,
+//whose blocks don't stop at the end of the range.  failed is set if there wasn't the
+//memory for a bucket, so a prime was left out of the worker's later blocks.
+typedef struct
+{
+	struct gsContext* gs;
+	u_int8_t* seg;
+	primePrinter text;
+	u_int64_t counts[4];
+	bucket** buckets;
+	u_int64_t bucketCount;
+	u_int64_t chunkLen;
+	bucket* freeBuckets;
+	smallPrime* small;
+	int openEnded;
+	int failed;
+} sieveWorker;
+
+//What a checkpoint file holds: the range, what was being done with it, and how far it
+//got.  Everything up to blockShift has to match for a range to be picked up from it.  
+//Every block before doneBlocks has been sieved and, if printing, written out, which
+//took the output up to outputBytes, and the counts are the counts up to there.  Like 
+//a store, the numbers are in the byte order of the machine that wrote it.
+typedef struct
+{
+	char magic[8];
+	u_int32_t version;
+	u_int32_t format;
+	u_int32_t printing;
+	u_int32_t counting;
+	u_int32_t calling;
+	u_int32_t unused;
+	u_int64_t minNum;
+	u_int64_t maxNum;
+	u_int64_t shardFirst;
+	u_int64_t shardBlocks;
+	u_int64_t blockShift;
+	u_int64_t doneBlocks;
+	u_int64_t outputBytes;
+	u_int64_t residueCounts[4];
+	u_int64_t otherCount;
+} gsCheckpoint;
+
+//Called with every prime gs_generate finds, in order, along with the data pointer
+//it was given
+typedef void (*gsCallback)(u_int64_t, void*);
+
+//Everything one sieve needs.  Nothing is shared between sieves, so several of them
+//can run at the same time in one program.  Set one up with gs_init and free it with
+//gs_free.  See the explanation in groupsieve.c for what the fields are for.
+typedef struct gsContext
+{
+	//Settings, which start out as what suits this machine
+	int numThreads;
+	u_int64_t blockSize;
+	int blockShift;
+	int wheelNum;
+	
+	//The range being sieved and what to do with the primes in it
+	u_int64_t minNum;
+	u_int64_t maxNum;
+	u_int64_t minSlot;
+	u_int64_t maxSlots;
+	int printing;
+	int counting;
+	int outputFd;
+	int format;
+	gsCallback callback;
+	void* callbackData;
+	
+	//When counting, the number of primes in the range ending in 1, 3, 7 and 9, and
+	//the number that are 2 or 5
+	u_int64_t residueCounts[4];
+	u_int64_t otherCount;
+	
+	//How many seconds each phase of the last range took, and the phase the calling 
+	//thread is in
+	double phaseTimes[PHASES];
+	int phase;
+	double phaseStart;
+	
+	//If perf is set, the hardware counters are read for each phase on every thread.
+	//perfCounts has perfThreads rows of them: the thread that called the sieve, the
+	//writer, and then the threads in the pool.  perfMissing has a bit set for each 
+	//counter that couldn't be opened.
+	int perf;
+	u_int64_t perfThreads;
+	u_int64_t (*perfCounts)[PHASES][PERF_EVENTS];
+	int perfMissing;
+	perfCounters callerCounters;
+	
+	//If checkpointPath is set, how far the range has got is saved there every 
+	//checkpointSeconds, in checkpoint.  The table is sieved a span of blocks at a 
+	//time, from firstSlot up to lastSlot, so there's a place to stop and save it.
+	//If resuming is set too, a range that was saved there is picked up from 
+	//resumeBlock, and resumed is set.  preamble is written before the primes, but
+	//not again when a range is picked up.
+	char* checkpointPath;
+	double checkpointSeconds;
+	double checkpointTime;
+	int resuming;
+	int resumed;
+	u_int64_t resumeBlock;
+	u_int64_t firstSlot;
+	u_int64_t lastSlot;
+	gsCheckpoint checkpoint;
+	char* preamble;
+	size_t preambleSize;
+	
+	//A range can be sieved a shard at a time, e.g. by several processes.  shardFirst
+	//and shardBlocks are the blocks of the range gs_set_shard says to sieve, or 0 and
+	//0 for all of them, and startBlock and endBlock are the blocks that are left to
+	//sieve once a checkpoint has been picked up.
+	u_int64_t shardFirst;
+	u_int64_t shardBlocks;
+	u_int64_t startBlock;
+	u_int64_t endBlock;
+	
+	//The sieving primes, and what we know about their cycles.  primes has room for 
+	//primeRoom of them.  The primes before largeIndex are smaller than a block.
+	u_int64_t primeCount;
+	u_int64_t startIndex;
+	u_int64_t largeIndex;
+	u_int64_t lastPrimeIndex;
+	u_int64_t primeRoom;
+	sievingPrime* primes;
+	
+	u_int8_t* wheel[2];
+	u_int64_t wheelSlots[2];
+	
+	//The small sieve that gets the sieving primes.  The primes in the first seedSlots
+	//slots of the table sieve the rest of it, which is done a block at a time.
+	//tablePrimes holds how many primes each block has, and then where they go in 
+	//the primes array.
+	u_int8_t* table;
+	u_int64_t tableSlots;
+	u_int64_t seedSlots;
+	u_int64_t seedIndex;
+	u_int64_t tableBlocks;
+	u_int64_t* tablePrimes;
+	u_int8_t tableMask;
+	
+	//The thread pool.  poolJob goes up by one every time there's a new job for the
+	//threads, poolTask is what they do for it, and poolBusy counts the threads still 
+	//working on it.  Threads take chunks in order by adding one to nextChunk.  poolNext
+	//hands the threads their numbers when they start.  The workers for a span are all
+	//allocated before the threads start on it, and each thread takes one by adding one
+	//to nextWorker.  failed is set once anything goes wrong partway through a range, and
+	//every thread stops at the next block.
+	void (*poolTask)(struct gsContext*);
+	pthread_t* poolThreads;
+	int poolSize;
+	int poolStarted;
+	int poolQuit;
+	u_int64_t poolJob;
+	int poolBusy;
+	int poolNext;
+	u_int64_t nextChunk;
+	u_int64_t chunkSlots;
+	sieveWorker* workers;
+	int workerCount;
+	int nextWorker;
+	int failed;
+	pthread_mutex_t poolLock;
+	pthread_cond_t poolWake;
+	pthread_cond_t poolDone;
+	
+	//The sieving primes are printed through this
+	primePrinter printer;
+	
+	//The writer thread and the blocks waiting for it.  Block n of the range is queued in 
+	//outputQueue[n % outputWindow], and not until block n-outputWindow has been written,
+	//so a thread that gets ahead waits instead of piling up text.  writing is set if 
+	//there's a writer, i.e. if we're printing or have a callback.
+	int writing;
+	pthread_t writer;
+	outputBlock* outputQueue;
+	u_int64_t outputWindow;
+	u_int64_t nextOutputBlock;
+	u_int64_t totalOutputBlocks;
+	pthread_mutex_t outputLock;
+	pthread_cond_t outputReady;
+	pthread_cond_t outputRoom;
+} gsContext;
+
+//Hands out the primes in a range one at a time, sieving a block whenever it runs out.
+//last is the last prime it handed out.
+typedef struct
+{
+	gsContext gs;
+	sieveWorker worker;
+	u_int64_t nextSmall;
+	u_int64_t nextBlock;
+	u_int64_t blockStart;
+	u_int64_t blockLen;
+	u_int64_t pos;
+	u_int8_t bits;
+	u_int64_t last;
+} gsIterator;
+
+//The header at the start of a file written by gs_save.  The slots from minSlot on come
+//right after it, laid out like the table, so a program can map the file and read them 
+//where they are.  It's 64 bytes so the slots start on a cache line.  The numbers are in
+//the byte order of the machine that wrote it.
+typedef struct
+{
+	char magic[8];
+	u_int32_t version;
+	u_int32_t wheel;
+	u_int64_t minNum;
+	u_int64_t maxNum;
+	u_int64_t minSlot;
+	u_int64_t slots;
+	u_int8_t unused[16];
+} gsStoreHeader;
+
+//A file written by gs_save, mapped into memory.  Set one up with gs_store_open and
+//free it with gs_store_close.  If gs_store_index has been called, ranks holds the 
+//number of set bits before every RANK_SLOTS slots, and selects the block of RANK_SLOTS
+//slots that the 1st, SELECT_SAMPLE+1th, 2*SELECT_SAMPLE+1th... bit is in.  bits is the
+//number of bits set in the whole table.
+typedef struct
+{
+	u_int8_t* map;
+	size_t mapSize;
+	gsStoreHeader* header;
+	u_int8_t* slots;
+	u_int64_t* ranks;
+	u_int64_t* selects;
+	u_int64_t bits;
+} gsStore;
+
+//The library
+void gs_init(gsContext*);
+void gs_free(gsContext*);
+void gs_set_threads(gsContext*, int);
+void gs_set_segment_size(gsContext*, u_int64_t);
+int gs_set_wheel(gsContext*, int);
+void gs_set_perf(gsContext*, int);
+int gs_set_format(gsContext*, int);
+void gs_set_checkpoint(gsContext*, char*, double, int);
+void gs_set_shard(gsContext*, u_int64_t, u_int64_t);
+u_int64_t gs_blocks(gsContext*, u_int64_t, u_int64_t);
+int gs_generate(gsContext*, u_int64_t, u_int64_t, gsCallback, void*);
+int gs_count(gsContext*, u_int64_t, u_int64_t, u_int64_t*);
+int gs_print(gsContext*, u_int64_t, u_int64_t, int);
+int gs_sieve(gsContext*, u_int64_t, u_int64_t, int, int);
+u_int64_t gs_counted(gsContext*);
+int gs_save(gsContext*, u_int64_t, u_int64_t, int);
+int gs_store_open(gsStore*, char*);
+int gs_store_map(gsStore*, int);
+void gs_store_close(gsStore*);
+int gs_store_is_prime(gsStore*, u_int64_t);
+u_int64_t gs_store_next_prime(gsStore*, u_int64_t);
+u_int64_t gs_store_range(gsStore*, u_int64_t, u_int64_t, gsCallback, void*);
+int gs_store_index(gsStore*);
+u_int64_t gs_store_pi(gsStore*, u_int64_t);
+u_int64_t gs_store_nth_prime(gsStore*, u_int64_t);
+int gs_iterator_init(gsIterator*, u_int64_t, u_int64_t);
+u_int64_t gs_next_prime(gsIterator*);
+int gs_iterator_failed(gsIterator*);
+int gs_iterator_extend(gsIterator*, u_int64_t);
+void gs_iterator_free(gsIterator*);
 
 #endif
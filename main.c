@@ -0,0 +1,2415 @@
+/*
+Copyright (c) 2014 Joseph B. Franks
+
+https://github.com/JosephFranks/groupsieve.git
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <poll.h>
+#include <math.h>
+#include <time.h>
+#include "groupsieve.h"
+#include "main.h"
+
+
+//The settings --bench tries, unless they're given on the command line.  The thread
+//counts are one thread and one per core, and the segment sizes are in kB.
+static const u_int64_t benchLimits[3] = {10000000ULL, 100000000ULL, 1000000000ULL};
+static const int benchWheels[3] = {1, 4, 6};
+static const u_int64_t benchSegments[3] = {16, 32, 256};
+
+//The number of primes up to 10^k, for --check
+static const u_int64_t knownPi[10] = {0, 4, 25, 168, 1229, 9592, 78498, 664579, 5761455, 50847534};
+
+//The thread counts and segment sizes in kB --check tries with every wheel.  A 1 kB 
+//segment makes even the small ranges take several blocks, and chunks with more than one thread.
+static const int checkThreads[3] = {1, 2, 4};
+static const u_int64_t checkSegments[2] = {1, 32};
+
+//Ranges --check always tries, which start or end on small primes or where they're missing
+static const u_int64_t checkEdges[8][2] = {{0, 1}, {2, 2}, {0, 2}, {5, 5}, {0, 20}, {19, 23}, {97, 97}, {1000000000, 1000000000}};
+
+//Ranges --check extends an iterator over, where it needs large primes and more buckets
+static const u_int64_t checkExtends[2][2] = {{1000000000ULL, 1200000000ULL}, {9600000000ULL, 9700000000ULL}};
+
+//What --format calls the formats, in the order of the FORMAT_ constants
+static const char* formatNames[FORMATS] = {"text", "u32", "u64", "delta8", "varint", "bitmap"};
+
+//What --perf calls the phases and the counters
+static const char* phaseNames[PHASES] = {"wheel", "bootstrap", "sieve", "output"};
+static const char* perfNames[PERF_EVENTS] = {"cycles", "instructions", "L1D misses", "LLC misses", "branch misses"};
+
+
+//This is the main function.  It takes arguments from the command line to determine
+//the range to sieve, the wheel size to use and whether or not to print out the primes.
+int main(int argc, char *argv[])
+{	
+	int wheelSize;
+	int i;
+	int print = 0;
+	int count = 0;
+	int bench = 0;
+	int json = 0;
+	int perf = 0;
+	int check = 0;
+	int format = -1;
+	char* savePath = NULL;
+	char* outputPath = NULL;
+	char* checkpointPath = NULL;
+	u_int64_t checkpointSeconds = CHECKPOINT_SECONDS;
+	int resume = 0;
+	int truncate;
+	u_int64_t localWorkers = 0;
+	char* hosts = NULL;
+	char* serveAddress = NULL;
+	int listenFd;
+	int port;
+	int numbers = 0;
+	char* numberArgs[3];
+	char* value;
+	u_int64_t start = 0;
+	u_int64_t stop = 0;
+	u_int64_t threads = 0;
+	u_int64_t segmentKB = 0;
+	u_int64_t runs = BENCH_RUNS;
+	int outputFd;
+	gsContext gs;
+	
+	//Start with the number of threads and block size that suit this machine.
+	//The options below can change them.
+	gs_init(&gs);
+	
+	//Sort the arguments into numbers and options
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] != '-')
+		{
+			if (numbers == 3)
+			{
+				printInstructions(argv[0], &gs);
+				return 1;
+			}
+			numberArgs[numbers++] = argv[i];
+		}
+		else if (isOption(argv[i], "print") || isOption(argv[i], "p"))
+		{
+			print = 1;
+		}
+		else if (isOption(argv[i], "count") || isOption(argv[i], "c"))
+		{
+			count = 1;
+		}
+		else if (isOption(argv[i], "check"))
+		{
+			check = 1;
+		}
+		else if (isOption(argv[i], "perf"))
+		{
+			perf = 1;
+		}
+		else if (isOption(argv[i], "bench"))
+		{
+			bench = 1;
+		}
+		else if ((value = optionValue(argc, argv, &i, "bench")) != NULL)
+		{
+			if ((strcmp(value, "csv") != 0) && (strcmp(value, "json") != 0))
+			{
+				printf("Error: --bench can only be csv or json\n");
+				return 1;
+			}
+			bench = 1;
+			json = (strcmp(value, "json") == 0);
+		}
+		else if ((value = optionValue(argc, argv, &i, "format")) != NULL)
+		{
+			for (format = FORMATS-1; (format >= 0) && (strcmp(value, formatNames[format]) != 0); format--);
+			if (format < 0)
+			{
+				printf("Error: --format must be text, u32, u64, delta8, varint or bitmap\n");
+				return 1;
+			}
+			gs_set_format(&gs, format);
+			print = 1;
+		}
+		else if ((value = optionValue(argc, argv, &i, "output")) != NULL)
+		{
+			outputPath = value;
+			print = 1;
+		}
+		else if ((value = optionValue(argc, argv, &i, "save")) != NULL)
+		{
+			savePath = value;
+		}
+		else if ((value = optionValue(argc, argv, &i, "checkpoint")) != NULL)
+		{
+			checkpointPath = value;
+		}
+		else if ((value = optionValue(argc, argv, &i, "checkpoint-every")) != NULL)
+		{
+			if (!readNumber(value, &checkpointSeconds))
+			{
+				printf("Error: --checkpoint-every must be a number of seconds\n");
+				return 1;
+			}
+		}
+		else if (isOption(argv[i], "resume"))
+		{
+			resume = 1;
+		}
+		else if ((value = optionValue(argc, argv, &i, "workers")) != NULL)
+		{
+			if ((!readNumber(value, &localWorkers)) || (localWorkers == 0) || (localWorkers > 1024))
+			{
+				printf("Error: --workers must be a number from 1 to 1024\n");
+				return 1;
+			}
+		}
+		else if ((value = optionValue(argc, argv, &i, "hosts")) != NULL)
+		{
+			hosts = value;
+		}
+		else if ((value = optionValue(argc, argv, &i, "serve")) != NULL)
+		{
+			serveAddress = value;
+		}
+		else if ((value = optionValue(argc, argv, &i, "runs")) != NULL)
+		{
+			if ((!readNumber(value, &runs)) || (runs == 0) || (runs > 1000))
+			{
+				printf("Error: --runs must be a number from 1 to 1000\n");
+				return 1;
+			}
+		}
+		else if ((value = optionValue(argc, argv, &i, "threads")) != NULL)
+		{
+			if ((!readNumber(value, &threads)) || (threads == 0) || (threads > MAX_THREADS))
+			{
+				printf("Error: --threads must be a number from 1 to %d\n", MAX_THREADS);
+				return 1;
+			}
+			gs_set_threads(&gs, threads);
+		}
+		else if ((value = optionValue(argc, argv, &i, "segment-size")) != NULL)
+		{
+			if ((!readNumber(value, &segmentKB)) || (segmentKB == 0) || (segmentKB > MAX_SEGMENT_KB))
+			{
+				printf("Error: --segment-size must be a number of kB from 1 to %d\n", MAX_SEGMENT_KB);
+				return 1;
+			}
+			gs_set_segment_size(&gs, segmentKB*1024);
+		}
+		else
+		{
+			printInstructions(argv[0], &gs);
+			return 1;
+		}
+	}
+	
+	//A worker waits for coordinators to send it shards, so it doesn't need a range
+	if (serveAddress != NULL)
+	{
+		if ((listenFd = listenWorkers(serveAddress, &port)) < 0)
+		{
+			printf("Error: can't wait for coordinators at %s\n", serveAddress);
+			return 1;
+		}
+		
+		printf("Waiting for shards on port %d\n", port);
+		fflush(stdout);
+		serveWorkers(listenFd);
+	}
+	
+	//The self test has its own ranges too
+	if (check)
+	{
+		gs_free(&gs);
+		return (runCheck() == 0) ? 0 : 1;
+	}
+	
+	//A benchmark doesn't need a range, since it has its own
+	if (bench && (numbers == 0))
+	{
+		gs_free(&gs);
+		runBench(0, 0, 0, threads, segmentKB, runs, print, json);
+		return 0;
+	}
+	
+	//Checks the program was passed the proper number of arguments
+	if (numbers < 2)
+	{
+        printInstructions(argv[0], &gs);
+		return 1;
+    }
+    
+    //If there are three numbers, the first one is where the range starts.  
+    //Otherwise we start at 0.
+    if ((numbers == 3) && (!readNumber(numberArgs[0], &start)))
+    {
+		printInstructions(argv[0], &gs);
+		return 1;
+	}
+	
+	//Get command line arguments
+	wheelSize = atoi(numberArgs[numbers-1]);
+    
+    //Checks the passed arguments are all integers and within bounds
+    if ((!readNumber(numberArgs[numbers-2], &stop)) || (stop == 0) || (start > stop) || (wheelSize <= 0) || (wheelSize > 6))
+    {
+		printInstructions(argv[0], &gs);
+		return 1;
+	}
+	
+	gs_set_wheel(&gs, wheelSize);
+	gs_set_perf(&gs, perf);
+	
+	if ((resume) && (checkpointPath == NULL))
+	{
+		printf("Error: --resume needs --checkpoint FILE to resume from\n");
+		return 1;
+	}
+	
+	if (((localWorkers > 0) || (hosts != NULL)) && ((savePath != NULL) || (checkpointPath != NULL)))
+	{
+		printf("Error: --workers and --hosts can't be used with --save or --checkpoint\n");
+		return 1;
+	}
+	
+	//When resuming, the output is kept, since the checkpoint says how much of it to keep
+	truncate = resume ? 0 : O_TRUNC;
+	if (checkpointPath != NULL)
+	{
+		gs_set_checkpoint(&gs, checkpointPath, checkpointSeconds, resume);
+	}
+	
+	//A benchmark of just this range and wheel
+	if (bench)
+	{
+		gs_free(&gs);
+		runBench(start, stop, wheelSize, threads, segmentKB, runs, print, json);
+		return 0;
+	}
+	
+	//Saving sieves the range into the file instead of printing it
+	if (savePath != NULL)
+	{
+		if ((outputFd = open(savePath, O_WRONLY | O_CREAT | truncate, 0644)) < 0)
+		{
+			printf("Error: can't open %s: %s\n", savePath, strerror(errno));
+			return 1;
+		}
+		
+		if (gs_save(&gs, start, stop, outputFd) != 0)
+		{
+			if (resume)
+			{
+				printf("Error: the checkpoint in %s isn't for this range, or %s doesn't have what it says was saved\n", checkpointPath, savePath);
+			}
+			else if (checkpointPath != NULL)
+			{
+				printf("Error: can't save the checkpoint in %s, or there isn't the memory to save %s\n", checkpointPath, savePath);
+			}
+			else
+			{
+				printf("Error: not enough memory to save %s\n", savePath);
+			}
+			return 1;
+		}
+		close(outputFd);
+		
+		if (count)
+		{
+			printCounts(&gs, stdout);
+		}
+		
+		gs_free(&gs);
+		return 0;
+	}
+	
+	if ((print) && (format == FORMAT_U32) && (stop > 4294967295ULL))
+	{
+		printf("Error: --format=u32 only goes up to 4294967295\n");
+		return 1;
+	}
+	
+	if (outputPath != NULL)
+	{
+		if ((outputFd = open(outputPath, O_WRONLY | O_CREAT | truncate, 0644)) < 0)
+		{
+			printf("Error: can't open %s: %s\n", outputPath, strerror(errno));
+			return 1;
+		}
+		gs.outputFd = outputFd;
+	}
+	
+	//With workers, they sieve the range a shard at a time
+	if ((localWorkers > 0) || (hosts != NULL))
+	{
+		if (runCoordinator(&gs, start, stop, print, count, localWorkers, hosts, threads) != 0)
+		{
+			printf("Error: a worker went away or couldn't sieve its shard\n");
+			return 1;
+		}
+		
+		if (count)
+		{
+			printCounts(&gs, print ? stderr : stdout);
+		}
+		
+		gs_free(&gs);
+		return 0;
+	}
+	
+	//The range has already been checked, so this can only fail if there's a checkpoint,
+	//there isn't the memory to sieve it or the primes can't be written
+	if (gs_sieve(&gs, start, stop, print, count) != 0)
+	{
+		if (resume)
+		{
+			printf("Error: the checkpoint in %s isn't for this range and these options, or the output can't be picked up where it says\n", checkpointPath);
+		}
+		else if (checkpointPath != NULL)
+		{
+			printf("Error: can't save the checkpoint in %s, or there isn't the memory to sieve the range or the primes can't be written\n", checkpointPath);
+		}
+		else
+		{
+			printf("Error: not enough memory to sieve the range, or the primes can't be written\n");
+		}
+		return 1;
+	}
+	
+	//Keep the counts out of the way of the primes if they're being printed too
+	if (count)
+	{
+		printCounts(&gs, print ? stderr : stdout);
+	}
+	
+	if (perf)
+	{
+		printPerf(&gs, print ? stderr : stdout);
+	}
+	
+	gs_free(&gs);
+	return 0;
+}
+
+//Print the instructions if input was not supplied properly
+void printInstructions(char* progName, gsContext* gs)
+{
+	printf("Proper usage is: \n");
+	printf("\n");
+    printf("%s [minInt] maxInt wheelSize [options]\n", progName );
+    printf("\n");
+	printf("minInt: Optional.  The positive integer you want to start finding primes at.\n");
+	printf("maxInt: The positive integer you want to find primes up to.\n");
+	printf("wheelSize: Can be any integer from 1-6.  See readme for more info.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("--print: Print out the primes.\n");
+	printf("--count: Print out how many primes there are, and how many end in 1, 3, 7 and 9.\n");
+	printf("--format F: Print out the primes as text (one per line), u32 or u64 (little endian), delta8\n");
+	printf("    (half the gap in a byte), varint (the gap as a LEB128 varint) or bitmap (the sieved\n");
+	printf("    table).  See the readme for the details.\n");
+	printf("--output FILE: Print out the primes to FILE instead of the console.\n");
+	printf("--save FILE: Save the sieved table to FILE, for gs_store_open to look primes up in.\n");
+	printf("--checkpoint FILE: Save how far the sieve has got to FILE every so often, so a run that\n");
+	printf("    gets stopped can be picked up with --resume.  Printing has to go to a file.\n");
+	printf("--checkpoint-every N: Save a checkpoint every N seconds.  Defaults to %d.\n", CHECKPOINT_SECONDS);
+	printf("--resume: Pick the run up from the checkpoint, with the same range and options, and\n");
+	printf("    carry on writing the output where it got to.  Without a checkpoint it starts over.\n");
+	printf("--workers N: Split the range into shards and sieve them with N processes on this machine,\n");
+	printf("    putting the primes and counts back together in order.\n");
+	printf("--hosts LIST: Sieve the shards with groupsieve --serve at each host:port in the comma\n");
+	printf("    separated LIST as well.\n");
+	printf("--serve [HOST:]PORT: Sieve shards for whoever connects at PORT, instead of a range.\n");
+	printf("    HOST defaults to %s; give 0.0.0.0 or another address to take shards from other\n", SERVE_HOST);
+	printf("    machines.  Nobody who connects is checked, so only do that on a network you trust.\n");
+	printf("--threads N: The number of threads to sieve with.  Defaults to the number of cores (%d here).\n", gs->numThreads);
+	printf("--segment-size N: The size of each thread's block, in kB.  It gets rounded down to a power \n");
+	printf("    of 2.  Defaults to the L1 data cache size (%llu kB here).\n", gs->blockSize/1024);
+	printf("--check: Check the sieve against the known number of primes up to 10^k and a simple \n");
+	printf("    sieve over random ranges, with every wheel and several thread counts.\n");
+	printf("--perf: Print the time, cycles, instructions, cache misses and branch mispredicts of each\n");
+	printf("    phase of the sieve, for all the threads and for each one.\n");
+	printf("--bench[=csv|json]: Time the sieve for a standard set of limits, wheels, thread counts and\n");
+	printf("    segment sizes, and print the median times.  The range, wheel, --threads and --segment-size\n");
+	printf("    narrow the set down to what's given.  With --print, the primes are printed to /dev/null.\n");
+	printf("--runs N: The number of timed runs --bench takes the median of.  Defaults to %d.\n", BENCH_RUNS);
+	printf("\n");
+	printf("If you're having trouble, the readme has a comprehensive explanation of the program and the inputs.\n");
+}
+
+//Checks whether arg is the option called name.  Options can start with one dash or two.
+int isOption(char* arg, char* name)
+{
+	if (arg[0] != '-')
+	{
+		return 0;
+	}
+	
+	arg++;
+	if (arg[0] == '-')
+	{
+		arg++;
+	}
+	
+	return (strcmp(arg, name) == 0);
+}
+
+//Checks whether argv[*i] is the option called name, which takes a value.  The value
+//can come after an = or be the next argument, in which case *i is moved past it.
+//Returns the value, or NULL if this isn't the option.
+char* optionValue(int argc, char* argv[], int* i, char* name)
+{
+	char* arg = argv[*i];
+	size_t nameLen = strlen(name);
+	
+	if (arg[0] != '-')
+	{
+		return NULL;
+	}
+	
+	arg++;
+	if (arg[0] == '-')
+	{
+		arg++;
+	}
+	
+	if (strncmp(arg, name, nameLen) != 0)
+	{
+		return NULL;
+	}
+	
+	if (arg[nameLen] == '=')
+	{
+		return arg + nameLen + 1;
+	}
+	
+	if ((arg[nameLen] == '\0') && (*i + 1 < argc))
+	{
+		(*i)++;
+		return argv[*i];
+	}
+	
+	return NULL;
+}
+
+//Reads a non-negative integer that fits in 64 bits from str.  Returns 0 if str
+//isn't one.
+int readNumber(char* str, u_int64_t* num)
+{
+	char* end;
+	
+	if ((str[0] < '0') || (str[0] > '9'))
+	{
+		return 0;
+	}
+	
+	errno = 0;
+	*num = strtoull(str, &end, 0);
+	
+	return ((errno == 0) && (*end == '\0'));
+}
+
+//Prints out the counts from the last range that was counted
+void printCounts(gsContext* gs, FILE* out)
+{
+	int digits[4] = {1, 3, 7, 9};
+	int i;
+	
+	fprintf(out, "%llu primes between %llu and %llu\n", gs_counted(gs), gs->minNum, gs->maxNum);
+	for (i = 0; i < 4; i++)
+	{
+		fprintf(out, "ending in %d: %llu\n", digits[i], gs->residueCounts[i]);
+	}
+	
+	fflush(out);
+}
+
+//Prints out the time and hardware counts of each phase of the last range, first for
+//all the threads together and then for each thread that did anything in it
+void printPerf(gsContext* gs, FILE* out)
+{
+	u_int64_t total[PERF_EVENTS];
+	u_int64_t row;
+	int phase;
+	int k;
+	int used;
+	char name[32];
+	
+	if (gs->perfMissing == (1 << PERF_EVENTS) - 1)
+	{
+		fprintf(out, "The hardware counters aren't available here (see /proc/sys/kernel/perf_event_paranoid)\n");
+	}
+	
+	fprintf(out, "%-10s %-8s %10s", "phase", "thread", "seconds");
+	for (k = 0; k < PERF_EVENTS; k++)
+	{
+		fprintf(out, " %14s", perfNames[k]);
+	}
+	fprintf(out, "\n");
+	
+	for (phase = 0; phase < PHASES; phase++)
+	{
+		memset(total, 0, sizeof(total));
+		for (row = 0; row < gs->perfThreads; row++)
+		{
+			for (k = 0; k < PERF_EVENTS; k++)
+			{
+				total[k] += gs->perfCounts[row][phase][k];
+			}
+		}
+		
+		//The phase's time is the time it took the thread that called the sieve
+		fprintf(out, "%-10s %-8s %10.6f", phaseNames[phase], "all", gs->phaseTimes[phase]);
+		printPerfCounts(gs, out, total);
+		
+		for (row = 0; row < gs->perfThreads; row++)
+		{
+			used = 0;
+			for (k = 0; k < PERF_EVENTS; k++)
+			{
+				used |= (gs->perfCounts[row][phase][k] != 0);
+			}
+			if (!used)
+			{
+				continue;
+			}
+			
+			if (row == 0)
+			{
+				snprintf(name, sizeof(name), "main");
+			}
+			else if (row == 1)
+			{
+				snprintf(name, sizeof(name), "writer");
+			}
+			else
+			{
+				snprintf(name, sizeof(name), "pool %llu", row-2);
+			}
+			
+			fprintf(out, "%-10s %-8s %10s", "", name, "");
+			printPerfCounts(gs, out, gs->perfCounts[row][phase]);
+		}
+	}
+	
+	fflush(out);
+}
+
+//Prints the rest of a line of printPerf's table.  Counters that couldn't be opened
+//are printed as -.
+void printPerfCounts(gsContext* gs, FILE* out, u_int64_t* counts)
+{
+	int k;
+	
+	for (k = 0; k < PERF_EVENTS; k++)
+	{
+		if (gs->perfMissing & (1 << k))
+		{
+			fprintf(out, " %14s", "-");
+		}
+		else
+		{
+			fprintf(out, " %14llu", counts[k]);
+		}
+	}
+	fprintf(out, "\n");
+}
+
+//Times the sieve for every combination of the settings in the bench arrays and prints
+//a line of CSV, or a JSON object, for each one.  A range, wheel, thread count or 
+//segment size that isn't 0 is used instead of the ones in the arrays.  The primes are 
+//always counted, so the number found can be checked from build to build, and if print
+//is set they're printed to /dev/null as well.
+void runBench(u_int64_t start, u_int64_t stop, int wheel, u_int64_t threads, u_int64_t segmentKB, u_int64_t runs, int print, int json)
+{
+	u_int64_t limits[3];
+	int wheels[3];
+	u_int64_t threadCounts[2];
+	u_int64_t segments[3];
+	int limitCount = 3;
+	int wheelCount = 3;
+	int threadCount = 2;
+	int segmentCount = 3;
+	int first = 1;
+	int l, w, t, s;
+	gsContext gs;
+	
+	memcpy(limits, benchLimits, sizeof(limits));
+	memcpy(wheels, benchWheels, sizeof(wheels));
+	memcpy(segments, benchSegments, sizeof(segments));
+	
+	//One thread per core is whatever the sieve starts out with
+	gs_init(&gs);
+	threadCounts[0] = 1;
+	threadCounts[1] = gs.numThreads;
+	if (threadCounts[1] == 1)
+	{
+		threadCount = 1;
+	}
+	gs_free(&gs);
+	
+	if (stop != 0)
+	{
+		limits[0] = stop;
+		limitCount = 1;
+	}
+	if (wheel != 0)
+	{
+		wheels[0] = wheel;
+		wheelCount = 1;
+	}
+	if (threads != 0)
+	{
+		threadCounts[0] = threads;
+		threadCount = 1;
+	}
+	if (segmentKB != 0)
+	{
+		segments[0] = segmentKB;
+		segmentCount = 1;
+	}
+	
+	if (json)
+	{
+		printf("[\n");
+	}
+	else
+	{
+		printf("start,stop,wheel,threads,segment_kb,runs,primes,median_s,wheel_s,bootstrap_s,sieve_s,output_s,primes_per_s\n");
+	}
+	
+	for (l = 0; l < limitCount; l++)
+	{
+		for (w = 0; w < wheelCount; w++)
+		{
+			for (t = 0; t < threadCount; t++)
+			{
+				for (s = 0; s < segmentCount; s++)
+				{
+					gs_init(&gs);
+					gs_set_threads(&gs, threadCounts[t]);
+					gs_set_segment_size(&gs, segments[s]*1024);
+					gs_set_wheel(&gs, wheels[w]);
+					
+					if ((json) && (!first))
+					{
+						printf(",\n");
+					}
+					benchSetting(&gs, start, limits[l], runs, print, json);
+					first = 0;
+					
+					gs_free(&gs);
+				}
+			}
+		}
+	}
+	
+	if (json)
+	{
+		printf("\n]\n");
+	}
+}
+
+//Sieves the range from start to stop with gs BENCH_WARMUP times, then runs more times,
+//timing each one, and prints the median of the total time and of each phase
+void benchSetting(gsContext* gs, u_int64_t start, u_int64_t stop, u_int64_t runs, int print, int json)
+{
+	double* times[PHASES+1];
+	double startTime;
+	double median[PHASES+1];
+	int nullFd = -1;
+	int run;
+	int k;
+	
+	for (k = 0; k <= PHASES; k++)
+	{
+		if ((times[k] = (double *) malloc(runs*sizeof(double))) == NULL)
+		{
+			printf("Error: problem allocating memory for the benchmark\n");
+			exit(-1);
+		}
+	}
+	
+	if (print)
+	{
+		if ((nullFd = open("/dev/null", O_WRONLY)) < 0)
+		{
+			printf("Error: can't open /dev/null\n");
+			exit(-1);
+		}
+		gs->outputFd = nullFd;
+	}
+	
+	for (run = -BENCH_WARMUP; run < (int) runs; run++)
+	{
+		startTime = benchTime();
+		gs_sieve(gs, start, stop, print, 1);
+		
+		if (run >= 0)
+		{
+			times[PHASES][run] = benchTime() - startTime;
+			for (k = 0; k < PHASES; k++)
+			{
+				times[k][run] = gs->phaseTimes[k];
+			}
+		}
+	}
+	
+	for (k = 0; k <= PHASES; k++)
+	{
+		median[k] = medianTime(times[k], runs);
+		free(times[k]);
+	}
+	
+	if (json)
+	{
+		printf("  {\"start\": %llu, \"stop\": %llu, \"wheel\": %d, \"threads\": %d, \"segment_kb\": %llu, ", start, stop, gs->wheelNum, gs->numThreads, gs->blockSize/1024);
+		printf("\"runs\": %llu, \"primes\": %llu, \"median_s\": %.6f, \"wheel_s\": %.6f, \"bootstrap_s\": %.6f, ", runs, gs_counted(gs), median[PHASES], median[PHASE_WHEEL], median[PHASE_PRIMES]);
+		printf("\"sieve_s\": %.6f, \"output_s\": %.6f, \"primes_per_s\": %.0f}", median[PHASE_SIEVE], median[PHASE_OUTPUT], gs_counted(gs)/median[PHASES]);
+	}
+	else
+	{
+		printf("%llu,%llu,%d,%d,%llu,%llu,%llu,", start, stop, gs->wheelNum, gs->numThreads, gs->blockSize/1024, runs, gs_counted(gs));
+		printf("%.6f,%.6f,%.6f,%.6f,%.6f,%.0f\n", median[PHASES], median[PHASE_WHEEL], median[PHASE_PRIMES], median[PHASE_SIEVE], median[PHASE_OUTPUT], gs_counted(gs)/median[PHASES]);
+	}
+	fflush(stdout);
+	
+	if (nullFd >= 0)
+	{
+		close(nullFd);
+	}
+}
+
+//For qsort, puts times in increasing order
+int compareTimes(const void* a, const void* b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	
+	return (x > y) - (x < y);
+}
+
+//Returns the median of the count times in times, which get sorted
+double medianTime(double* times, u_int64_t count)
+{
+	qsort(times, count, sizeof(double), compareTimes);
+	
+	if (count % 2 == 0)
+	{
+		return (times[count/2-1] + times[count/2])/2;
+	}
+	
+	return times[count/2];
+}
+
+//Returns the time in seconds on a clock that never goes backwards, for timing runs
+double benchTime()
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+//Checks every way of getting primes out of the sieve, with every wheel and the thread
+//counts and segment sizes in checkThreads and checkSegments.  The counts up to each
+//power of 10 are compared with knownPi, and the primes in checkEdges and some random 
+//ranges are compared with referenceSieve's.  The random ranges are the same every time.
+//Prints a line for each test that fails, and returns the number that did.
+int runCheck()
+{
+	u_int64_t seed = 20141020;
+	u_int64_t start;
+	u_int64_t stop;
+	u_int64_t power = 1;
+	u_int64_t count;
+	primeCheck expected;
+	primeCheck found;
+	gsContext gs;
+	int tests = 0;
+	int failures = 0;
+	int w, t, s, k;
+	
+	for (k = 1; k < 9; k++)
+	{
+		power *= 10;
+		initCheck(&expected);
+		expected.count = knownPi[k];
+		
+		for (w = 1; w <= 6; w++)
+		{
+			for (t = 0; t < 3; t++)
+			{
+				for (s = 0; s < 2; s++)
+				{
+					gs_init(&gs);
+					gs_set_wheel(&gs, w);
+					gs_set_threads(&gs, checkThreads[t]);
+					gs_set_segment_size(&gs, checkSegments[s]*1024);
+					
+					initCheck(&found);
+					gs_count(&gs, 0, power, &count);
+					found.count = count;
+					checkResult("count", 0, power, w, checkThreads[t], checkSegments[s], &expected, &found, &tests, &failures);
+					
+					gs_free(&gs);
+				}
+			}
+		}
+	}
+	
+	for (k = 0; k < 8; k++)
+	{
+		checkRange(checkEdges[k][0], checkEdges[k][1], &expected, &tests, &failures);
+	}
+	
+	//Iterators extended over ranges where, with 32 kB blocks, the sieving primes start
+	//being bigger than a block, and then where the buckets that already have primes
+	//in them have to be spread over more buckets.  They're compared with gs_generate.
+	for (k = 0; k < 2; k++)
+	{
+		initCheck(&expected);
+		gs_init(&gs);
+		gs_generate(&gs, checkExtends[k][0], checkExtends[k][1], checkPrime, &expected);
+		gs_free(&gs);
+		checkExtend(checkExtends[k][0], checkExtends[k][1], &expected, &tests, &failures);
+	}
+	
+	//Runs that are stopped partway through and picked up again
+	checkResume(1000000000000ULL, 1000200000000ULL, 1, &tests, &failures);
+	checkResume(1000000000000ULL, 1000200000000ULL, 0, &tests, &failures);
+	
+	//Ranges split into shards for other processes, starting with one where the 
+	//sieving primes are in the range and one where the last shard is just the half
+	//block at the end
+	checkShards(0, 10000000, FORMAT_DELTA8, 0, &tests, &failures);
+	checkShards(0, 501760, FORMAT_TEXT, 0, &tests, &failures);
+	checkShards(1000000000, 1050000000, FORMAT_BITMAP, 0, &tests, &failures);
+	checkShards(1000000000000ULL, 1000020000000ULL, FORMAT_TEXT, 1, &tests, &failures);
+	checkBadShards(&tests, &failures);
+	
+	//Random ranges starting anywhere below 10^12
+	for (k = 0; k < CHECK_INTERVALS; k++)
+	{
+		start = checkRandom(&seed) % 1000000000000ULL;
+		stop = start + checkRandom(&seed) % CHECK_SPAN;
+		checkRange(start, stop, &expected, &tests, &failures);
+	}
+	
+	printf("%d of %d tests passed\n", tests - failures, tests);
+	fflush(stdout);
+	
+	return failures;
+}
+
+//Gets the primes from start to stop from referenceSieve, then checks gs_count, 
+//gs_generate and gs_print find the same ones with every setting, and that an 
+//iterator does too
+void checkRange(u_int64_t start, u_int64_t stop, primeCheck* expected, int* tests, int* failures)
+{
+	u_int64_t count;
+	u_int64_t prime;
+	primeCheck found;
+	gsContext gs;
+	gsIterator it;
+	int format;
+	char test[32];
+	int w, t, s;
+	
+	initCheck(expected);
+	referenceSieve(start, stop, expected);
+	
+	for (w = 1; w <= 6; w++)
+	{
+		for (t = 0; t < 3; t++)
+		{
+			for (s = 0; s < 2; s++)
+			{
+				gs_init(&gs);
+				gs_set_wheel(&gs, w);
+				gs_set_threads(&gs, checkThreads[t]);
+				gs_set_segment_size(&gs, checkSegments[s]*1024);
+				
+				//Counting only gives the number of primes
+				initCheck(&found);
+				gs_count(&gs, start, stop, &count);
+				found.count = count;
+				found.sum = expected->sum;
+				checkResult("count", start, stop, w, checkThreads[t], checkSegments[s], expected, &found, tests, failures);
+				
+				initCheck(&found);
+				gs_generate(&gs, start, stop, checkPrime, &found);
+				checkResult("generate", start, stop, w, checkThreads[t], checkSegments[s], expected, &found, tests, failures);
+				
+				//Each setting prints in a different format, and u32 falls back to text when
+				//the range is too big for it
+				format = (w + t + s) % FORMATS;
+				if ((format == FORMAT_U32) && (stop > 4294967295ULL))
+				{
+					format = FORMAT_TEXT;
+				}
+				gs_set_format(&gs, format);
+				
+				initCheck(&found);
+				printedPrimes(&gs, start, stop, &found);
+				snprintf(test, sizeof(test), "print %s", formatNames[format]);
+				checkResult(test, start, stop, w, checkThreads[t], checkSegments[s], expected, &found, tests, failures);
+				
+				gs_free(&gs);
+			}
+		}
+	}
+	
+	checkStore(start, stop, expected, tests, failures);
+	
+	initCheck(&found);
+	gs_iterator_init(&it, start, stop);
+	while ((prime = gs_next_prime(&it)) != 0)
+	{
+		checkPrime(prime, &found);
+	}
+	gs_iterator_free(&it);
+	checkResult("iterator", start, stop, 6, 1, 0, expected, &found, tests, failures);
+	
+	checkExtend(start, stop, expected, tests, failures);
+}
+
+//Checks an iterator that starts on a small piece of the range from start to stop and
+//is extended to the rest of it a bit at a time finds the expected primes.  Every other 
+//piece is only partly used up before it's extended.
+void checkExtend(u_int64_t start, u_int64_t stop, primeCheck* expected, int* tests, int* failures)
+{
+	primeCheck found;
+	gsIterator it;
+	u_int64_t end = start + (stop-start)/64;
+	u_int64_t prime;
+	int piece;
+	int n;
+	
+	initCheck(&found);
+	gs_iterator_init(&it, start, end);
+	
+	for (piece = 0; ; piece++)
+	{
+		for (n = 0; ((piece % 2 == 0) || (end == stop) || (n < 50)) && ((prime = gs_next_prime(&it)) != 0); n++)
+		{
+			checkPrime(prime, &found);
+		}
+		
+		if (end == stop)
+		{
+			break;
+		}
+		
+		end += (stop - end)/2 + 1;
+		gs_iterator_extend(&it, end);
+	}
+	
+	gs_iterator_free(&it);
+	checkResult("extend", start, stop, 6, 1, 0, expected, &found, tests, failures);
+}
+
+//Counts the primes from start to stop, and prints them in delta8 too if print is set,
+//in another process that saves a checkpoint after every span and is killed as soon as
+//one says it's partway through.  Then picks the run up with other threads and block 
+//size, and checks the count is right and the output is the same as it is in one go.
+void checkResume(u_int64_t start, u_int64_t stop, int print, int* tests, int* failures)
+{
+	char path[] = "/tmp/groupsieve-checkpoint-XXXXXX";
+	FILE* output;
+	FILE* expected;
+	gsContext gs;
+	pid_t child;
+	u_int64_t count;
+	u_int64_t found;
+	int result;
+	int status;
+	int fd;
+	int same = 1;
+	
+	if (((fd = mkstemp(path)) < 0) || ((output = tmpfile()) == NULL) || ((expected = tmpfile()) == NULL))
+	{
+		printf("Error: can't make a temporary file\n");
+		exit(-1);
+	}
+	close(fd);
+	
+	//What it should come to, with the block size the run that gets stopped has
+	gs_init(&gs);
+	gs_set_segment_size(&gs, 1024);
+	gs_set_format(&gs, FORMAT_DELTA8);
+	gs.outputFd = fileno(expected);
+	gs_sieve(&gs, start, stop, print, 1);
+	count = gs_counted(&gs);
+	gs_free(&gs);
+	
+	fflush(stdout);
+	if ((child = fork()) < 0)
+	{
+		printf("Error: can't start another process\n");
+		exit(-1);
+	}
+	
+	if (child == 0)
+	{
+		gs_init(&gs);
+		gs_set_threads(&gs, 2);
+		gs_set_segment_size(&gs, 1024);
+		gs_set_format(&gs, FORMAT_DELTA8);
+		gs_set_checkpoint(&gs, path, 0, 0);
+		gs.outputFd = fileno(output);
+		gs_sieve(&gs, start, stop, print, 1);
+		_exit(0);
+	}
+	
+	while (waitpid(child, &status, WNOHANG) == 0)
+	{
+		if (checkpointBlocks(path) > 0)
+		{
+			kill(child, SIGKILL);
+			waitpid(child, &status, 0);
+			break;
+		}
+		usleep(1000);
+	}
+	
+	gs_init(&gs);
+	gs_set_threads(&gs, 3);
+	gs_set_segment_size(&gs, 32*1024);
+	gs_set_format(&gs, FORMAT_DELTA8);
+	gs_set_checkpoint(&gs, path, 0, 1);
+	gs.outputFd = fileno(output);
+	result = gs_sieve(&gs, start, stop, print, 1);
+	found = gs_counted(&gs);
+	gs_free(&gs);
+	
+	if (print)
+	{
+		same = sameFiles(output, expected);
+	}
+	
+	(*tests)++;
+	if ((result != 0) || (found != count) || (!same))
+	{
+		(*failures)++;
+		printf("FAILED: resume %s %llu to %llu: %llu primes, expected %llu%s\n", print ? "print delta8" : "count", start, stop, found, count, same ? "" : ", output differs");
+		fflush(stdout);
+	}
+	
+	fclose(output);
+	fclose(expected);
+	unlink(path);
+}
+
+//Prints the range from start to stop in format and counts it with three workers with 
+//1 kB blocks, which are processes of their own or, if served is set, connections to
+//groupsieve --serve in another process, then counts it again without printing.  Checks
+//both counts are right and the output is the same as it is in one go.
+void checkShards(u_int64_t start, u_int64_t stop, int format, int served, int* tests, int* failures)
+{
+	shardWorker workers[3];
+	pid_t pids[3];
+	pid_t server = 0;
+	char address[32];
+	FILE* output;
+	FILE* expected;
+	gsContext gs;
+	u_int64_t count;
+	u_int64_t found;
+	u_int64_t counted;
+	int listenFd;
+	int port;
+	int result;
+	int same;
+	int i;
+	
+	if (((output = tmpfile()) == NULL) || ((expected = tmpfile()) == NULL))
+	{
+		printf("Error: can't make a temporary file\n");
+		exit(-1);
+	}
+	
+	gs_init(&gs);
+	gs_set_segment_size(&gs, 1024);
+	gs_set_format(&gs, format);
+	gs.outputFd = fileno(expected);
+	gs_sieve(&gs, start, stop, 1, 1);
+	count = gs_counted(&gs);
+	
+	if (served)
+	{
+		if ((listenFd = listenWorkers("127.0.0.1:0", &port)) < 0)
+		{
+			printf("Error: can't listen for workers\n");
+			exit(-1);
+		}
+		
+		fflush(stdout);
+		if ((server = fork()) == 0)
+		{
+			serveWorkers(listenFd);
+		}
+		close(listenFd);
+		
+		snprintf(address, sizeof(address), "127.0.0.1:%d", port);
+		for (i = 0; i < 3; i++)
+		{
+			if ((workers[i].fd = connectWorker(address)) < 0)
+			{
+				printf("Error: can't connect to the workers\n");
+				exit(-1);
+			}
+			workers[i].threads = 1;
+		}
+	}
+	else if (startWorkers(workers, 3, 1, pids) != 0)
+	{
+		printf("Error: can't start the workers\n");
+		exit(-1);
+	}
+	
+	gs.outputFd = fileno(output);
+	result = runShards(&gs, start, stop, 1, 1, workers, 3);
+	found = gs_counted(&gs);
+	
+	//Counting alone doesn't go through the writer, so it ends its shards on its own
+	if (runShards(&gs, start, stop, 0, 1, workers, 3) != 0)
+	{
+		result = -1;
+	}
+	counted = gs_counted(&gs);
+	gs_free(&gs);
+	
+	for (i = 0; i < 3; i++)
+	{
+		close(workers[i].fd);
+	}
+	if (served)
+	{
+		kill(server, SIGKILL);
+		waitpid(server, NULL, 0);
+	}
+	else
+	{
+		for (i = 0; i < 3; i++)
+		{
+			waitpid(pids[i], NULL, 0);
+		}
+	}
+	
+	same = sameFiles(output, expected);
+	
+	(*tests)++;
+	if ((result != 0) || (found != count) || (counted != count) || (!same))
+	{
+		(*failures)++;
+		printf("FAILED: %s %s %llu to %llu: %llu primes printed and %llu counted, expected %llu%s\n", served ? "served shards" : "shards", formatNames[format], start, stop, found, counted, count, same ? "" : ", output differs");
+		fflush(stdout);
+	}
+	
+	fclose(output);
+	fclose(expected);
+}
+
+//Returns how many blocks the checkpoint at path says are done, or 0 if there isn't one
+u_int64_t checkpointBlocks(char* path)
+{
+	gsCheckpoint cp;
+	int fd;
+	ssize_t got;
+	
+	if ((fd = open(path, O_RDONLY)) < 0)
+	{
+		return 0;
+	}
+	
+	got = read(fd, &cp, sizeof(cp));
+	close(fd);
+	
+	return (got == sizeof(cp)) ? cp.doneBlocks : 0;
+}
+
+//Returns 1 if the two files have the same bytes in them
+int sameFiles(FILE* a, FILE* b)
+{
+	char bufA[65536];
+	char bufB[65536];
+	size_t lenA;
+	size_t lenB;
+	
+	rewind(a);
+	rewind(b);
+	do
+	{
+		lenA = fread(bufA, 1, sizeof(bufA), a);
+		lenB = fread(bufB, 1, sizeof(bufB), b);
+		if ((lenA != lenB) || (memcmp(bufA, bufB, lenA) != 0))
+		{
+			return 0;
+		}
+	} while (lenA > 0);
+	
+	return 1;
+}
+
+//Saves the range from start to stop with gs_save, and checks that gs_store_range, 
+//following gs_store_next_prime from one prime to the next and gs_store_is_prime on 
+//every number all find the expected primes
+void checkStore(u_int64_t start, u_int64_t stop, primeCheck* expected, int* tests, int* failures)
+{
+	FILE* file;
+	gsContext gs;
+	gsStore st;
+	primeCheck found;
+	u_int64_t prime;
+	u_int64_t n;
+	
+	if ((file = tmpfile()) == NULL)
+	{
+		printf("Error: can't make a temporary file\n");
+		exit(-1);
+	}
+	
+	gs_init(&gs);
+	gs_save(&gs, start, stop, fileno(file));
+	gs_free(&gs);
+	
+	if (gs_store_map(&st, fileno(file)) != 0)
+	{
+		initCheck(&found);
+		found.ordered = 0;
+		checkResult("store open", start, stop, 6, 0, 0, expected, &found, tests, failures);
+		fclose(file);
+		return;
+	}
+	
+	initCheck(&found);
+	gs_store_range(&st, start, stop, checkPrime, &found);
+	checkResult("store range", start, stop, 6, 0, 0, expected, &found, tests, failures);
+	
+	//The first prime is the next one after start-1, or start itself if start is 0
+	initCheck(&found);
+	prime = (start == 0) ? gs_store_next_prime(&st, 0) : gs_store_next_prime(&st, start-1);
+	for (; prime != 0; prime = gs_store_next_prime(&st, prime))
+	{
+		checkPrime(prime, &found);
+	}
+	checkResult("store next", start, stop, 6, 0, 0, expected, &found, tests, failures);
+	
+	initCheck(&found);
+	for (n = start; n <= stop; n++)
+	{
+		if (gs_store_is_prime(&st, n) == 1)
+		{
+			checkPrime(n, &found);
+		}
+	}
+	checkResult("store is_prime", start, stop, 6, 0, 0, expected, &found, tests, failures);
+	
+	checkIndex(&st, start, stop, expected, tests, failures);
+	
+	gs_store_close(&st);
+	checkStoreHeader(fileno(file), start, stop, tests, failures);
+	fclose(file);
+}
+
+//Breaks the header of the store in fd one field at a time, and checks that 
+//gs_store_map turns every one of them down instead of mapping slots that aren't there
+void checkStoreHeader(int fd, u_int64_t start, u_int64_t stop, int* tests, int* failures)
+{
+	gsStoreHeader good;
+	gsStoreHeader bad;
+	gsStore st;
+	int broken = 0;
+	int k;
+	
+	if (pread(fd, &good, sizeof(good), 0) != sizeof(good))
+	{
+		printf("Error: can't read the store back\n");
+		exit(-1);
+	}
+	
+	for (k = 0; k < 5; k++)
+	{
+		bad = good;
+		switch (k)
+		{
+			case 0: bad.minSlot++; break;
+			case 1: bad.minNum = bad.maxNum+1; break;
+			case 2: bad.maxNum += 20; break;
+			case 3: bad.slots++; break;
+			case 4: bad.minNum += 20; break;
+		}
+		
+		if (pwrite(fd, &bad, sizeof(bad), 0) != sizeof(bad))
+		{
+			printf("Error: can't write the store's header\n");
+			exit(-1);
+		}
+		
+		if (gs_store_map(&st, fd) == 0)
+		{
+			gs_store_close(&st);
+			broken++;
+		}
+	}
+	
+	if (pwrite(fd, &good, sizeof(good), 0) != sizeof(good))
+	{
+		printf("Error: can't write the store's header\n");
+		exit(-1);
+	}
+	
+	(*tests)++;
+	if (broken > 0)
+	{
+		(*failures)++;
+		printf("FAILED: store header %llu to %llu: %d broken headers were mapped\n", start, stop, broken);
+		fflush(stdout);
+	}
+}
+
+//Indexes a store of the range from start to stop, and checks that gs_store_pi goes up 
+//by one at every expected prime and nowhere else, and that gs_store_nth_prime finds 
+//them all in order
+void checkIndex(gsStore* st, u_int64_t start, u_int64_t stop, primeCheck* expected, int* tests, int* failures)
+{
+	primeCheck found;
+	u_int64_t last = 0;
+	u_int64_t pi;
+	u_int64_t prime;
+	u_int64_t n;
+	
+	if (gs_store_index(st) != 0)
+	{
+		printf("Error: problem allocating memory for the index\n");
+		exit(-1);
+	}
+	
+	initCheck(&found);
+	for (n = start; n <= stop; n++)
+	{
+		pi = gs_store_pi(st, n);
+		if (pi == last + 1)
+		{
+			checkPrime(n, &found);
+		}
+		else if (pi != last)
+		{
+			found.ordered = 0;
+		}
+		last = pi;
+	}
+	checkResult("store pi", start, stop, 6, 0, 0, expected, &found, tests, failures);
+	
+	initCheck(&found);
+	for (n = 1; (prime = gs_store_nth_prime(st, n)) != 0; n++)
+	{
+		checkPrime(prime, &found);
+	}
+	checkResult("store nth", start, stop, 6, 0, 0, expected, &found, tests, failures);
+}
+
+//Counts one test, and prints it out if found doesn't match expected
+void checkResult(char* test, u_int64_t start, u_int64_t stop, int wheel, int threads, u_int64_t segmentKB, primeCheck* expected, primeCheck* found, int* tests, int* failures)
+{
+	(*tests)++;
+	
+	if ((found->count == expected->count) && (found->sum == expected->sum) && (found->ordered))
+	{
+		return;
+	}
+	
+	(*failures)++;
+	printf("FAILED: %s %llu to %llu, wheel %d, %d threads, %llu kB segments: ", test, start, stop, wheel, threads, segmentKB);
+	printf("%llu primes (checksum %llx), expected %llu (checksum %llx)%s\n", found->count, found->sum, expected->count, expected->sum, found->ordered ? "" : ", out of order");
+	fflush(stdout);
+}
+
+//Starts a check with no primes in it
+void initCheck(primeCheck* check)
+{
+	check->count = 0;
+	check->sum = 0;
+	check->last = 0;
+	check->ordered = 1;
+}
+
+//Adds a prime to the check data points to.  The checksum depends on the order the
+//primes come in as well as what they are.
+void checkPrime(u_int64_t prime, void* data)
+{
+	primeCheck* check = (primeCheck *) data;
+	
+	if ((check->count > 0) && (prime <= check->last))
+	{
+		check->ordered = 0;
+	}
+	
+	check->count++;
+	check->sum = check->sum*31 + prime;
+	check->last = prime;
+}
+
+//Prints the primes from start to stop to a temporary file with gs_print and reads 
+//them back into check, in whatever format the sieve prints in
+void printedPrimes(gsContext* gs, u_int64_t start, u_int64_t stop, primeCheck* check)
+{
+	FILE* file;
+	u_int8_t* buf;
+	long size;
+	long i;
+	u_int64_t prime = 0;
+	u_int64_t value;
+	int shift;
+	int k;
+	
+	if ((file = tmpfile()) == NULL)
+	{
+		printf("Error: can't make a temporary file\n");
+		exit(-1);
+	}
+	
+	gs_print(gs, start, stop, fileno(file));
+	
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	if ((buf = (u_int8_t *) malloc(size+1)) == NULL)
+	{
+		printf("Error: problem allocating memory for the printed primes\n");
+		exit(-1);
+	}
+	size = fread(buf, 1, size, file);
+	buf[size] = '\0';
+	fclose(file);
+	
+	i = 0;
+	while (i < size)
+	{
+		switch (gs->format)
+		{
+			case FORMAT_TEXT:
+				prime = strtoull((char *) buf+i, NULL, 10);
+				while (buf[i++] != '\n');
+				break;
+			case FORMAT_U32:
+			case FORMAT_U64:
+				prime = 0;
+				for (k = ((gs->format == FORMAT_U32) ? 4 : 8) - 1; k >= 0; k--)
+				{
+					prime = (prime << 8) | buf[i+k];
+				}
+				i += (gs->format == FORMAT_U32) ? 4 : 8;
+				break;
+			case FORMAT_DELTA8:
+				if (buf[i] != 0)
+				{
+					prime += 2*buf[i++];
+					break;
+				}
+				prime = 0;
+				for (k = 8; k >= 1; k--)
+				{
+					prime = (prime << 8) | buf[i+k];
+				}
+				i += 9;
+				break;
+			case FORMAT_VARINT:
+				//A gap of 0 means the prime comes next in full
+				for (k = 0; k < 2; k++)
+				{
+					value = 0;
+					shift = 0;
+					do
+					{
+						value |= (u_int64_t) (buf[i] & 127) << shift;
+						shift += 7;
+					} while (buf[i++] & 128);
+					
+					if ((k == 1) || (value != 0))
+					{
+						break;
+					}
+				}
+				prime = (k == 1) ? value : prime + value;
+				break;
+			case FORMAT_BITMAP:
+				//The bitmap starts at the slot holding start, and has no bits for 2 and 5
+				for (k = 0; k < 8; k++)
+				{
+					if (buf[i] & (1 << k))
+					{
+						prime = (start/20 + i)*20 + (k < 4 ? 0 : 10) + "\1\3\7\11"[k & 3];
+						if ((prime > 2) && (start <= 2) && (stop >= 2) && (check->count == 0))
+						{
+							checkPrime(2, check);
+						}
+						if ((prime > 5) && (start <= 5) && (stop >= 5) && (check->last < 5))
+						{
+							checkPrime(5, check);
+						}
+						checkPrime(prime, check);
+					}
+				}
+				i++;
+				continue;
+		}
+		
+		checkPrime(prime, check);
+	}
+	
+	//2 and 5 when nothing after them is
+	if ((gs->format == FORMAT_BITMAP) && (start <= 5) && (stop >= 2))
+	{
+		if ((start <= 2) && (check->count == 0))
+		{
+			checkPrime(2, check);
+		}
+		if ((stop >= 5) && (check->last < 5))
+		{
+			checkPrime(5, check);
+		}
+	}
+	
+	free(buf);
+}
+
+//Finds the primes from start to stop, inclusive, the simplest way there is, to check
+//the sieve against.  The primes up to sqrt(stop) are found with a plain sieve of 
+//Eratosthenes, and their multiples are crossed off one number at a time.  The ranges
+//are far too small for sqrtl to be off.
+void referenceSieve(u_int64_t start, u_int64_t stop, primeCheck* check)
+{
+	u_int64_t root = sqrtl(stop);
+	u_int64_t len = stop - start + 1;
+	u_int64_t p;
+	u_int64_t m;
+	u_int8_t* small;
+	u_int8_t* range;
+	
+	if (((small = (u_int8_t *) malloc(root+1)) == NULL) || ((range = (u_int8_t *) malloc(len)) == NULL))
+	{
+		printf("Error: problem allocating memory for the reference sieve\n");
+		exit(-1);
+	}
+	
+	memset(small, 1, root+1);
+	memset(range, 1, len);
+	
+	for (p = 2; p <= root; p++)
+	{
+		if (!small[p])
+		{
+			continue;
+		}
+		
+		for (m = p*p; m <= root; m += p)
+		{
+			small[m] = 0;
+		}
+		
+		//The first multiple of p in the range, other than p itself
+		m = (start + p-1)/p*p;
+		if (m < p*p)
+		{
+			m = p*p;
+		}
+		for (; m <= stop; m += p)
+		{
+			range[m-start] = 0;
+		}
+	}
+	
+	for (m = start; m <= stop; m++)
+	{
+		if ((m >= 2) && (range[m-start]))
+		{
+			checkPrime(m, check);
+		}
+	}
+	
+	free(small);
+	free(range);
+}
+
+//Returns the next number from a xorshift generator, so the random ranges are the same
+//on every machine
+u_int64_t checkRandom(u_int64_t* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	
+	return *state;
+}
+
+//Sieves the range from start to stop with localWorkers processes on this machine and 
+//groupsieve --serve at each of the comma separated addresses in hosts, if it isn't NULL.
+//threads is what --threads said, or 0, in which case the processes here share the cores
+//and the hosts use their own.  Returns -1 if a worker goes away or can't sieve a shard.
+int runCoordinator(gsContext* gs, u_int64_t start, u_int64_t stop, int print, int count, int localWorkers, char* hosts, u_int64_t threads)
+{
+	shardWorker* workers;
+	pid_t* pids;
+	char* list = NULL;
+	char* address;
+	int numWorkers = localWorkers;
+	int localThreads;
+	int result;
+	int i;
+	
+	for (i = 0; (hosts != NULL) && (hosts[i] != '\0'); i++)
+	{
+		numWorkers += (i == 0) || (hosts[i] == ',');
+	}
+	
+	if (((workers = (shardWorker *) malloc(numWorkers*sizeof(shardWorker))) == NULL) || ((pids = (pid_t *) malloc((localWorkers+1)*sizeof(pid_t))) == NULL))
+	{
+		printf("Error: problem allocating memory for the workers\n");
+		exit(-1);
+	}
+	
+	//The processes are started before connecting to the hosts, so they don't keep
+	//those connections open
+	localThreads = threads;
+	if ((threads == 0) && (localWorkers > 0))
+	{
+		localThreads = (gs->numThreads > localWorkers) ? gs->numThreads/localWorkers : 1;
+	}
+	
+	if (startWorkers(workers, localWorkers, localThreads, pids) != 0)
+	{
+		printf("Error: can't start the workers\n");
+		exit(-1);
+	}
+	
+	numWorkers = localWorkers;
+	if ((hosts != NULL) && ((list = strdup(hosts)) == NULL))
+	{
+		printf("Error: problem allocating memory for the hosts\n");
+		exit(-1);
+	}
+	
+	for (address = (list != NULL) ? strtok(list, ",") : NULL; address != NULL; address = strtok(NULL, ","))
+	{
+		if ((workers[numWorkers].fd = connectWorker(address)) < 0)
+		{
+			printf("Error: can't reach a worker at %s\n", address);
+			exit(-1);
+		}
+		workers[numWorkers].threads = threads;
+		numWorkers++;
+	}
+	
+	result = (numWorkers > 0) ? runShards(gs, start, stop, print, count, workers, numWorkers) : -1;
+	
+	//The workers stop when they see we've hung up
+	for (i = 0; i < numWorkers; i++)
+	{
+		close(workers[i].fd);
+	}
+	for (i = 0; i < localWorkers; i++)
+	{
+		waitpid(pids[i], NULL, 0);
+	}
+	
+	free(list);
+	free(pids);
+	free(workers);
+	
+	return result;
+}
+
+/*
+A range can also be split into shards that are sieved by other processes, on this machine
+or on others, and put back together in order.  A shard is a run of blocks of the range
+(see gs_set_shard), so every worker sieves with the sieving primes of the whole range, and
+the output of the shards one after another is exactly the output of the whole range.  The
+range is split into SHARDS_PER_WORKER shards for each worker, which are handed out in order
+to whichever worker is free, so a slow worker just ends up with fewer of them.  A shard's
+output is written straight out if every shard before it has been, and otherwise it's kept
+in a temporary file until they have.  Like the writer thread's queue, shards aren't handed
+out more than SHARD_WINDOW per worker past the next one to write, so one slow worker can't
+leave the coordinator holding most of the output.  The workers are either processes started
+with --workers, which each get one end of a socket pair, or groupsieve --serve on the --hosts,
+which are connected to over TCP.  Either way they get the same shardRequests and send back 
+the same shardReplies.
+*/
+
+//Sieves the range from start to stop with the workers, writing the primes to the sieve's
+//outputFd if print is set and leaving the counts in the sieve if count is set.  Returns
+//-1 if a worker goes away or can't sieve a shard.
+int runShards(gsContext* gs, u_int64_t start, u_int64_t stop, int print, int count, shardWorker* workers, int numWorkers)
+{
+	u_int64_t blocks = gs_blocks(gs, start, stop);
+	u_int64_t shards = (u_int64_t) numWorkers*SHARDS_PER_WORKER;
+	u_int64_t shardBlocks;
+	u_int64_t next = 0;
+	u_int64_t written = 0;
+	u_int64_t first;
+	FILE** pending;
+	u_int8_t* done;
+	struct pollfd* polls;
+	int result = 0;
+	int got;
+	int i, k;
+	
+	//The last shard can be a bit short
+	if (shards > blocks)
+	{
+		shards = blocks;
+	}
+	shardBlocks = (blocks + shards-1)/shards;
+	shards = (blocks + shardBlocks-1)/shardBlocks;
+	
+	gs->minNum = start;
+	gs->maxNum = stop;
+	memset(gs->residueCounts, 0, sizeof(gs->residueCounts));
+	gs->otherCount = 0;
+	
+	if (((pending = (FILE **) calloc(shards, sizeof(FILE*))) == NULL) || ((done = (u_int8_t *) calloc(shards, 1)) == NULL) || ((polls = (struct pollfd *) malloc(numWorkers*sizeof(struct pollfd))) == NULL))
+	{
+		printf("Error: problem allocating memory for the shards\n");
+		exit(-1);
+	}
+	
+	for (i = 0; i < numWorkers; i++)
+	{
+		workers[i].shard = -1;
+	}
+	
+	while ((written < shards) && (result == 0))
+	{
+		for (i = 0; (i < numWorkers) && (result == 0); i++)
+		{
+			if ((workers[i].shard < 0) && (next < shards) && (next < written + (u_int64_t) SHARD_WINDOW*numWorkers))
+			{
+				first = next*shardBlocks;
+				result = sendShard(gs, &workers[i], start, stop, first, (blocks - first < shardBlocks) ? blocks - first : shardBlocks, print, count);
+				workers[i].shard = next++;
+			}
+			
+			//A worker with nothing to do is left out, in case it's hung up
+			polls[i].fd = (workers[i].shard >= 0) ? workers[i].fd : -1;
+			polls[i].events = POLLIN;
+		}
+		
+		if ((result != 0) || (poll(polls, numWorkers, -1) < 0))
+		{
+			if ((result == 0) && (errno == EINTR))
+			{
+				continue;
+			}
+			result = -1;
+			break;
+		}
+		
+		for (i = 0; (i < numWorkers) && (result == 0); i++)
+		{
+			if ((polls[i].revents == 0) || (workers[i].shard < 0))
+			{
+				continue;
+			}
+			
+			if ((got = readShard(&workers[i], pending, written, print ? gs->outputFd : -1)) < 0)
+			{
+				result = -1;
+			}
+			else if (got == 1)
+			{
+				for (k = 0; k < 4; k++)
+				{
+					gs->residueCounts[k] += workers[i].reply.residueCounts[k];
+				}
+				gs->otherCount += workers[i].reply.otherCount;
+				
+				done[workers[i].shard] = 1;
+				workers[i].shard = -1;
+			}
+		}
+		
+		//Write out the shards that are next, and whatever has come in of the one after 
+		//them, which can go straight out from now on
+		while ((written < shards) && ((done[written]) || (pending[written] != NULL)))
+		{
+			if (pending[written] != NULL)
+			{
+				writeShard(pending[written], gs->outputFd);
+				fclose(pending[written]);
+				pending[written] = NULL;
+			}
+			
+			if (!done[written])
+			{
+				break;
+			}
+			written++;
+		}
+	}
+	
+	for (next = 0; next < shards; next++)
+	{
+		if (pending[next] != NULL)
+		{
+			fclose(pending[next]);
+		}
+	}
+	free(pending);
+	free(done);
+	free(polls);
+	
+	return result;
+}
+
+//Sends the worker the shard of blocks from first up to first+blocks of the range from 
+//start to stop, with the sieve's settings.  Returns -1 if the worker has gone away.
+int sendShard(gsContext* gs, shardWorker* worker, u_int64_t start, u_int64_t stop, u_int64_t first, u_int64_t blocks, int print, int count)
+{
+	shardRequest request;
+	
+	memset(&request, 0, sizeof(request));
+	memcpy(request.magic, SHARD_MAGIC, 8);
+	request.start = start;
+	request.stop = stop;
+	request.firstBlock = first;
+	request.blocks = blocks;
+	request.blockShift = gs->blockShift;
+	request.wheel = gs->wheelNum;
+	request.threads = worker->threads;
+	request.format = gs->format;
+	request.printing = print;
+	request.counting = count;
+	
+	worker->got = 0;
+	worker->left = 0;
+	
+	return sendAll(worker->fd, &request, sizeof(request));
+}
+
+//Reads what's come in from a worker.  The reply comes first, and then the output, which
+//goes straight to fd if the worker's shard is the next one to write, or to a temporary
+//file in pending until it is.  Returns 1 once the whole shard is in, 0 if there's more 
+//to come, or -1 if the worker has gone away or couldn't sieve it.
+int readShard(shardWorker* worker, FILE** pending, u_int64_t written, int fd)
+{
+	char buf[65536];
+	ssize_t got;
+	
+	if (worker->got < sizeof(shardReply))
+	{
+		if ((got = recv(worker->fd, (char *) &worker->reply + worker->got, sizeof(shardReply) - worker->got, 0)) <= 0)
+		{
+			return ((got < 0) && (errno == EINTR)) ? 0 : -1;
+		}
+		
+		worker->got += got;
+		if (worker->got < sizeof(shardReply))
+		{
+			return 0;
+		}
+		
+		if (worker->reply.bytes < 0)
+		{
+			return -1;
+		}
+		
+		worker->left = worker->reply.bytes;
+		return (worker->left == 0);
+	}
+	
+	if ((got = recv(worker->fd, buf, (worker->left < sizeof(buf)) ? worker->left : sizeof(buf), 0)) <= 0)
+	{
+		return ((got < 0) && (errno == EINTR)) ? 0 : -1;
+	}
+	
+	if ((u_int64_t) worker->shard == written)
+	{
+		writeOutput(fd, buf, got);
+	}
+	else
+	{
+		if ((pending[worker->shard] == NULL) && ((pending[worker->shard] = tmpfile()) == NULL))
+		{
+			printf("Error: can't make a temporary file\n");
+			exit(-1);
+		}
+		
+		if (fwrite(buf, 1, got, pending[worker->shard]) != (size_t) got)
+		{
+			perror("Error keeping a shard");
+			exit(-1);
+		}
+	}
+	
+	worker->left -= got;
+	return (worker->left == 0);
+}
+
+//Writes what's been kept in file out to fd
+void writeShard(FILE* file, int fd)
+{
+	char buf[65536];
+	size_t got;
+	
+	rewind(file);
+	while ((got = fread(buf, 1, sizeof(buf), file)) > 0)
+	{
+		writeOutput(fd, buf, got);
+	}
+}
+
+//This is a worker.  It sieves the shards that come in on fd and sends back what it finds,
+//until the coordinator hangs up.  The output of a shard goes to a temporary file first, 
+//since the reply says how long it is.
+void serveShards(int fd)
+{
+	shardRequest request;
+	shardReply reply;
+	gsContext gs;
+	FILE* output;
+	char buf[65536];
+	ssize_t got;
+	int threads;
+	int gone = 0;
+	
+	gs_init(&gs);
+	threads = gs.numThreads;
+	
+	while ((!gone) && (receiveAll(fd, &request, sizeof(request)) == 0) && (memcmp(request.magic, SHARD_MAGIC, 8) == 0))
+	{
+		if ((output = tmpfile()) == NULL)
+		{
+			printf("Error: can't make a temporary file\n");
+			exit(-1);
+		}
+		
+		gs.outputFd = fileno(output);
+		
+		memset(&reply, 0, sizeof(reply));
+		if ((setShard(&gs, &request, threads) != 0) || (gs_sieve(&gs, request.start, request.stop, request.printing, request.counting) != 0))
+		{
+			reply.bytes = -1;
+		}
+		else
+		{
+			reply.bytes = lseek(gs.outputFd, 0, SEEK_CUR);
+			memcpy(reply.residueCounts, gs.residueCounts, sizeof(reply.residueCounts));
+			reply.otherCount = gs.otherCount;
+		}
+		
+		gone = (sendAll(fd, &reply, sizeof(reply)) != 0);
+		
+		lseek(gs.outputFd, 0, SEEK_SET);
+		while ((!gone) && (reply.bytes > 0) && ((got = read(gs.outputFd, buf, sizeof(buf))) > 0))
+		{
+			gone = (sendAll(fd, buf, got) != 0);
+		}
+		
+		fclose(output);
+	}
+	
+	gs_free(&gs);
+}
+
+//Sets gs up to sieve the shard in request, with threads threads if the request leaves
+//it to the worker.  Returns -1 if the request asks for something a coordinator never
+//would: a range that's the wrong way round, blocks that aren't all in it, or more threads
+//or a bigger block than --threads and --segment-size take.  That's all that's checked;
+//there's no telling who sent it.
+int setShard(gsContext* gs, shardRequest* request, int threads)
+{
+	u_int64_t total;
+	
+	if ((request->start > request->stop) || (request->threads > MAX_THREADS) || (request->blockShift < 10) || (request->blockShift > 40) || ((1ULL << (request->blockShift-10)) > MAX_SEGMENT_KB))
+	{
+		return -1;
+	}
+	
+	if ((gs_set_wheel(gs, request->wheel) != 0) || (gs_set_format(gs, request->format) != 0))
+	{
+		return -1;
+	}
+	
+	gs_set_segment_size(gs, 1ULL << request->blockShift);
+	total = gs_blocks(gs, request->start, request->stop);
+	if ((request->blocks == 0) || (request->firstBlock >= total) || (request->blocks > total - request->firstBlock))
+	{
+		return -1;
+	}
+	
+	gs_set_threads(gs, (request->threads > 0) ? (int) request->threads : threads);
+	gs_set_shard(gs, request->firstBlock, request->blocks);
+	return 0;
+}
+
+//Sends a worker shards that no coordinator would, one setting at a time, and checks it
+//turns every one of them down instead of sieving it
+void checkBadShards(int* tests, int* failures)
+{
+	shardWorker worker;
+	shardRequest good;
+	shardRequest bad;
+	shardReply reply;
+	pid_t pid;
+	int sieved = 0;
+	int k;
+	
+	if (startWorkers(&worker, 1, 1, &pid) != 0)
+	{
+		printf("Error: can't start a worker\n");
+		exit(-1);
+	}
+	
+	//0 to 1000000 is 49 blocks of 1 kB
+	memset(&good, 0, sizeof(good));
+	memcpy(good.magic, SHARD_MAGIC, 8);
+	good.start = 0;
+	good.stop = 1000000;
+	good.firstBlock = 0;
+	good.blocks = 49;
+	good.blockShift = 10;
+	good.wheel = 6;
+	good.format = FORMAT_TEXT;
+	good.counting = 1;
+	
+	for (k = 0; k < 8; k++)
+	{
+		bad = good;
+		switch (k)
+		{
+			case 0: bad.start = bad.stop+1; break;
+			case 1: bad.firstBlock = 49; break;
+			case 2: bad.blocks = 50; break;
+			case 3: bad.blocks = 0; break;
+			case 4: bad.firstBlock = ~0ULL; break;
+			case 5: bad.threads = MAX_THREADS+1; break;
+			case 6: bad.blockShift = 63; break;
+			case 7: bad.format = FORMATS; break;
+		}
+		
+		if ((sendAll(worker.fd, &bad, sizeof(bad)) != 0) || (receiveAll(worker.fd, &reply, sizeof(reply)) != 0))
+		{
+			printf("Error: the worker went away\n");
+			exit(-1);
+		}
+		sieved += (reply.bytes >= 0);
+	}
+	
+	close(worker.fd);
+	waitpid(pid, NULL, 0);
+	
+	(*tests)++;
+	if (sieved > 0)
+	{
+		(*failures)++;
+		printf("FAILED: bad shards: %d of them were sieved\n", sieved);
+		fflush(stdout);
+	}
+}
+
+//Waits for coordinators to connect to listenFd, and serves each one in a process of
+//its own.  It never returns.
+void serveWorkers(int listenFd)
+{
+	int fd;
+	pid_t pid;
+	
+	//Nobody waits for the processes, so they don't hang around when they're done
+	signal(SIGCHLD, SIG_IGN);
+	
+	while (1)
+	{
+		if ((fd = accept(listenFd, NULL, NULL)) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("Error waiting for a coordinator");
+			exit(-1);
+		}
+		
+		if ((pid = fork()) == 0)
+		{
+			close(listenFd);
+			serveShards(fd);
+			_exit(0);
+		}
+		
+		if (pid < 0)
+		{
+			perror("Error starting a worker");
+		}
+		close(fd);
+	}
+}
+
+//Starts count worker processes on this machine, each on one end of a socket pair, and 
+//puts the other ends in workers.  Each one is told to use threads threads.  Returns -1 if
+//they can't all be started.
+int startWorkers(shardWorker* workers, int count, int threads, pid_t* pids)
+{
+	int fds[2];
+	int i, j;
+	
+	fflush(stdout);
+	for (i = 0; i < count; i++)
+	{
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		{
+			return -1;
+		}
+		
+		if ((pids[i] = fork()) < 0)
+		{
+			return -1;
+		}
+		
+		//The workers before this one have to see the coordinator hang up, so this one
+		//can't keep their sockets open
+		if (pids[i] == 0)
+		{
+			close(fds[0]);
+			for (j = 0; j < i; j++)
+			{
+				close(workers[j].fd);
+			}
+			serveShards(fds[1]);
+			_exit(0);
+		}
+		
+		close(fds[1]);
+		workers[i].fd = fds[0];
+		workers[i].threads = threads;
+	}
+	
+	return 0;
+}
+
+//Connects to groupsieve --serve at address, which is host:port.  Returns the socket, or
+//-1 if it can't be reached.
+int connectWorker(char* address)
+{
+	struct addrinfo hints;
+	struct addrinfo* found;
+	struct addrinfo* a;
+	char* host;
+	char* port;
+	int fd = -1;
+	
+	if (splitAddress(address, &host, &port) != 0)
+	{
+		return -1;
+	}
+	
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	
+	if (getaddrinfo((host[0] != '\0') ? host : NULL, port, &hints, &found) == 0)
+	{
+		for (a = found; (a != NULL) && (fd < 0); a = a->ai_next)
+		{
+			if (((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) >= 0) && (connect(fd, a->ai_addr, a->ai_addrlen) != 0))
+			{
+				close(fd);
+				fd = -1;
+			}
+		}
+		freeaddrinfo(found);
+	}
+	
+	free(host);
+	return fd;
+}
+
+//Listens for coordinators at address, which is [host:]port, and sets *port to the port,
+//which is picked by the system if it's 0.  Without a host it only listens on SERVE_HOST,
+//since anyone who can connect can have it sieve whatever they like; other interfaces
+//have to be asked for by address.  Returns the socket, or -1 if it can't listen there.
+int listenWorkers(char* address, int* boundPort)
+{
+	struct addrinfo hints;
+	struct addrinfo* found;
+	struct sockaddr_storage bound;
+	socklen_t boundLen = sizeof(bound);
+	char* host;
+	char* port;
+	int fd;
+	int on = 1;
+	
+	if (splitAddress(address, &host, &port) != 0)
+	{
+		return -1;
+	}
+	
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	
+	if (getaddrinfo((host[0] != '\0') ? host : SERVE_HOST, port, &hints, &found) != 0)
+	{
+		free(host);
+		return -1;
+	}
+	free(host);
+	
+	if (((fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol)) < 0) || (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0) || (bind(fd, found->ai_addr, found->ai_addrlen) != 0) || (listen(fd, 64) != 0) || (getsockname(fd, (struct sockaddr *) &bound, &boundLen) != 0))
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		freeaddrinfo(found);
+		return -1;
+	}
+	freeaddrinfo(found);
+	
+	*boundPort = ntohs((bound.ss_family == AF_INET6) ? ((struct sockaddr_in6 *) &bound)->sin6_port : ((struct sockaddr_in *) &bound)->sin_port);
+	return fd;
+}
+
+//Splits an address of the form [host:]port.  *host is set to a copy of it with just the
+//host in it, which is empty if there isn't one, and *port to the port, which is in the
+//same copy.  An IPv6 host can go in brackets.  Returns -1 if there's no port, and 
+//otherwise *host has to be freed.
+int splitAddress(char* address, char** host, char** port)
+{
+	char* colon;
+	size_t len;
+	
+	if ((*host = (char *) malloc(strlen(address) + 2)) == NULL)
+	{
+		printf("Error: problem allocating memory for an address\n");
+		exit(-1);
+	}
+	
+	if ((colon = strrchr(address, ':')) == NULL)
+	{
+		(*host)[0] = '\0';
+		strcpy(*host + 1, address);
+		*port = *host + 1;
+	}
+	else
+	{
+		strcpy(*host, address);
+		len = colon - address;
+		(*host)[len] = '\0';
+		*port = *host + len + 1;
+		
+		if ((len >= 2) && ((*host)[0] == '[') && ((*host)[len-1] == ']'))
+		{
+			(*host)[len-1] = '\0';
+			memmove(*host, *host + 1, len-1);
+		}
+	}
+	
+	if ((*port)[0] == '\0')
+	{
+		free(*host);
+		return -1;
+	}
+	
+	return 0;
+}
+
+//Sends all len bytes in buf to the socket fd.  Returns -1 if the other end has gone away.
+int sendAll(int fd, void* buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t sent;
+	
+	while (done < len)
+	{
+		//Without MSG_NOSIGNAL, a worker that's gone away would kill us with SIGPIPE
+		if ((sent = send(fd, (char *) buf + done, len - done, MSG_NOSIGNAL)) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		done += sent;
+	}
+	
+	return 0;
+}
+
+//Reads len bytes from the socket fd into buf.  Returns -1 if the other end hangs up 
+//before they've all come.
+int receiveAll(int fd, void* buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t got;
+	
+	while (done < len)
+	{
+		if ((got = recv(fd, (char *) buf + done, len - done, 0)) <= 0)
+		{
+			if ((got < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+			return -1;
+		}
+		done += got;
+	}
+	
+	return 0;
+}
+
+//Writes len bytes of output to fd, which is a file or the console rather than a socket
+void writeOutput(int fd, char* buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t written;
+	
+	while (done < len)
+	{
+		if ((written = write(fd, buf + done, len - done)) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			
+			perror("Error writing primes");
+			exit(-1);
+		}
+		done += written;
+	}
+}
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2014 Joseph B. Franks
+https://github.com/JosephFranks/groupsieve.git
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "groupsieve.h"
+
+#ifndef MAIN_H
+#define MAIN_H
+
+//What the groupsieve program needs on top of the library: the settings and structures
+//of --bench, --check and the shards, and the program's own functions.
+#define BENCH_RUNS 5 //The number of timed runs --bench takes the median of for each setting
+#define BENCH_WARMUP 1 //The number of runs --bench throws away before timing a setting
+#define CHECK_INTERVALS 8 //The number of random ranges --check compares with the reference sieve
+#define CHECK_SPAN 1000000 //The most numbers in one of those ranges
+#define CHECKPOINT_SECONDS 60 //How often --checkpoint saves one, unless --checkpoint-every says otherwise
+#define SHARD_MAGIC "gsshard\0" //The first 8 bytes of a shard sent to a worker
+#define SHARDS_PER_WORKER 8 //The number of shards a range is split into for each worker
+#define SHARD_WINDOW 2 //How many shards per worker can be handed out past the next one to write
+#define MAX_THREADS 4096 //The most threads --threads, or a shard sent to a worker, can ask for
+#define MAX_SEGMENT_KB 1048576 //The biggest block --segment-size, or a shard sent to a worker, can ask for
+#define SERVE_HOST "127.0.0.1" //Where --serve listens when it isn't given a host
+
+//A shard of a range that the coordinator sends a worker: the blocks from firstBlock
+//up to firstBlock+blocks of the range from start to stop, and what to do with them.
+//threads is 0 for the worker to use its own default.  Like a store, the numbers are
+//in the byte order of the machine that sent it.
+typedef struct
+{
+	char magic[8];
+	u_int64_t start;
+	u_int64_t stop;
+	u_int64_t firstBlock;
+	u_int64_t blocks;
+	u_int32_t blockShift;
+	u_int32_t wheel;
+	u_int32_t threads;
+	u_int32_t format;
+	u_int32_t printing;
+	u_int32_t counting;
+} shardRequest;
+
+//What a worker sends back for a shard: its counts, and the number of bytes of output 
+//that come right after this, or -1 if it couldn't be sieved
+typedef struct
+{
+	int64_t bytes;
+	u_int64_t residueCounts[4];
+	u_int64_t otherCount;
+} shardReply;
+
+//A worker, from the coordinator's side: the socket it's on, the threads it's told to 
+//use, the shard it's working on or -1, how much of the reply has come in and how 
+//many bytes of output are still to come
+typedef struct
+{
+	int fd;
+	int threads;
+	int64_t shard;
+	shardReply reply;
+	size_t got;
+	u_int64_t left;
+} shardWorker;
+
+//The number of primes --check has been handed, a checksum of them, and whether they
+//came in increasing order
+typedef struct
+{
+	u_int64_t count;
+	u_int64_t sum;
+	u_int64_t last;
+	int ordered;
+} primeCheck;
+
+//Function declarations
+void printInstructions(char*, gsContext*);
+int readNumber(char*, u_int64_t*);
+int isOption(char*, char*);
+char* optionValue(int, char**, int*, char*);
+void printCounts(gsContext*, FILE*);
+void printPerf(gsContext*, FILE*);
+void printPerfCounts(gsContext*, FILE*, u_int64_t*);
+int runCheck();
+void checkRange(u_int64_t, u_int64_t, primeCheck*, int*, int*);
+void checkStore(u_int64_t, u_int64_t, primeCheck*, int*, int*);
+void checkStoreHeader(int, u_int64_t, u_int64_t, int*, int*);
+void checkExtend(u_int64_t, u_int64_t, primeCheck*, int*, int*);
+void checkResume(u_int64_t, u_int64_t, int, int*, int*);
+void checkShards(u_int64_t, u_int64_t, int, int, int*, int*);
+void checkBadShards(int*, int*);
+u_int64_t checkpointBlocks(char*);
+int sameFiles(FILE*, FILE*);
+void checkIndex(gsStore*, u_int64_t, u_int64_t, primeCheck*, int*, int*);
+void checkResult(char*, u_int64_t, u_int64_t, int, int, u_int64_t, primeCheck*, primeCheck*, int*, int*);
+void initCheck(primeCheck*);
+void checkPrime(u_int64_t, void*);
+void printedPrimes(gsContext*, u_int64_t, u_int64_t, primeCheck*);
+void referenceSieve(u_int64_t, u_int64_t, primeCheck*);
+u_int64_t checkRandom(u_int64_t*);
+int runCoordinator(gsContext*, u_int64_t, u_int64_t, int, int, int, char*, u_int64_t);
+int runShards(gsContext*, u_int64_t, u_int64_t, int, int, shardWorker*, int);
+int sendShard(gsContext*, shardWorker*, u_int64_t, u_int64_t, u_int64_t, u_int64_t, int, int);
+int readShard(shardWorker*, FILE**, u_int64_t, int);
+void writeShard(FILE*, int);
+void serveShards(int);
+int setShard(gsContext*, shardRequest*, int);
+void serveWorkers(int);
+int startWorkers(shardWorker*, int, int, pid_t*);
+int connectWorker(char*);
+int listenWorkers(char*, int*);
+int splitAddress(char*, char**, char**);
+int sendAll(int, void*, size_t);
+int receiveAll(int, void*, size_t);
+void writeOutput(int, char*, size_t);
+void runBench(u_int64_t, u_int64_t, int, u_int64_t, u_int64_t, u_int64_t, int, int);
+void benchSetting(gsContext*, u_int64_t, u_int64_t, u_int64_t, int, int);
+int compareTimes(const void*, const void*);
+double medianTime(double*, u_int64_t);
+double benchTime();
+
+#endif